@@ -0,0 +1,632 @@
+/* shack-bench: a small benchmark suite for shack
+ *
+ *   shack-bench [--runs n] [--only name] [--save file.json] [--baseline file.json]
+ *
+ * Each workload is a bit of Scheme that defines (bench-run); bench-run does "ops" operations.
+ * We time each call with CLOCK_MONOTONIC, and report the median ns/op over the runs, along with
+ * the cells and mallocate bytes per op from (*shack* 'gc-counters).  The results are written as JSON to
+ * stdout (or to the --save file); --baseline reads a file written by --save and shows the change.
+ *
+ * Some workloads also check their results (raising an error, which stops shack-bench, if they're wrong).
+ *
+ * The medians hide the occasional very slow operation, so "hash-insert-latency" also times each of
+ * LATENCY_INSERTS hash-table-set! calls into a growing table, and reports the median of each run's
+ * p50, p99, p99.9 and max insert time.
+ *
+ * "shack-call", "prepared-call" and "batch-call" time C_CALLS calls of a two-argument handler from C,
+ * through shack_call, through a shack_prepare_call handle, and BATCH_SIZE at a time through shack_call_batch.
+ *
+ * build: gcc bench/shack-bench.c shack.c -o shack-bench -I. -O2 -ldl -lm -Wl,-export-dynamic
+ *   or use the CMake "bench" target: cmake --build . --target bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shack.h"
+
+typedef struct
+{
+	const char* name;
+	shack_int ops;
+	const char* code;
+} workload_t;
+
+static workload_t workloads[] =
+{
+	{"gc-churn", 200000,
+	 "(define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 200000))                                  \n\
+	      (vector (list i i) (make-string 3 #\\a))))"},
+
+	{"list-ops", 1000,
+	 "(define bench-list (do ((i 0 (+ i 1)) (lst () (cons i lst))) ((= i 1000) lst))) \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((lst (reverse bench-list)))                                   \n\
+	      (length (map (lambda (x) (+ x 1)) (append lst (list-tail lst 500)))) \n\
+	      (assv 999 (map (lambda (x) (cons x x)) lst))))"},
+
+	{"vector-ops", 100000,
+	 "(define bench-vector (make-vector 100000 1))                          \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((sum 0))                                                      \n\
+	      (do ((i 0 (+ i 1))) ((= i 100000) sum)                           \n\
+	        (vector-set! bench-vector i (+ (vector-ref bench-vector i) 1)) \n\
+	        (set! sum (+ sum (vector-ref bench-vector i))))))"},
+
+	{"hash-table", 50000,
+	 "(define (bench-run)                                                   \n\
+	    (let ((h (make-hash-table)))                                        \n\
+	      (do ((i 0 (+ i 1))) ((= i 25000))                                 \n\
+	        (hash-table-set! h i (* i 2))                                   \n\
+	        (hash-table-set! h (number->string i) i))                       \n\
+	      (do ((i 0 (+ i 1)) (sum 0 (+ sum (hash-table-ref h i)))) ((= i 25000) sum))))"},
+
+	{"string-port", 50000,
+	 "(define (bench-run)                                                   \n\
+	    (call-with-output-string                                            \n\
+	      (lambda (p)                                                       \n\
+	        (do ((i 0 (+ i 1))) ((= i 50000))                               \n\
+	          (write-char #\\x p)                                           \n\
+	          (display i p)))))"},
+
+	{"string-port-big", 200000,
+	 "(define bench-line (make-string 63 #\\x))                            \n\
+	  (define (bench-run)                                                   \n\
+	    (with-output-to-string                                              \n\
+	      (lambda ()                                                        \n\
+	        (do ((i 0 (+ i 1))) ((= i 200000))                              \n\
+	          (write-string bench-line)                                     \n\
+	          (newline)))))"},
+
+	{"reader", 2000,
+	 "(define bench-text \"(define (f x) (let ((y (* x 2.5))) (if (> y 1) \\\"big\\\" #\\\\s)) '(a b . c) #(1 2 3))\") \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 2000))                                    \n\
+	      (read (open-input-string bench-text))))"},
+
+	/* 1000 records in one string, read one after another (as in a data file) with read, then with read-data.
+	 *   read-data is only about 1.1x faster here; it is about 1.5x faster on files over 5MB, which read takes a character at a time.
+	 */
+	{"read-bulk", 1000,
+	 "(define bench-records                                                 \n\
+	    (call-with-output-string                                            \n\
+	      (lambda (p)                                                       \n\
+	        (do ((i 0 (+ i 1))) ((= i 1000))                                \n\
+	          (format p \"(record ~D \\\"name-~D\\\" ~A sym~D #(1 2 ~D) (a . b) #t)~%\" i i (* i 1.25) (modulo i 100) i))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((p (open-input-string bench-records)))                        \n\
+	      (do ((x (read p) (read p))) ((eof-object? x)))))"},
+
+	{"read-data", 1000,
+	 "(define bench-data-records                                            \n\
+	    (call-with-output-string                                            \n\
+	      (lambda (p)                                                       \n\
+	        (do ((i 0 (+ i 1))) ((= i 1000))                                \n\
+	          (format p \"(record ~D \\\"name-~D\\\" ~A sym~D #(1 2 ~D) (a . b) #t)~%\" i i (* i 1.25) (modulo i 100) i))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((p (open-input-string bench-data-records)))                   \n\
+	      (do ((x (read-data p) (read-data p))) ((eof-object? x)))))"},
+
+	/* 1000 JSON records, read back with read-json (this also times write-json building the text once); "done" is false */
+	{"json", 1000,
+	 "(define bench-json                                                    \n\
+	    (call-with-output-string                                            \n\
+	      (lambda (p)                                                       \n\
+	        (do ((i 0 (+ i 1))) ((= i 1000))                                \n\
+	          (write-json (inlet 'id i 'name (format #f \"name-~D\" i) 'score (* i 1.25) 'v (vector 1 2 i) 'ok #t 'done #f) p) \n\
+	          (newline p))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((p (open-input-string bench-json)))                           \n\
+	      (do ((x (read-json p) (read-json p))) ((eof-object? x)))))"},
+
+	/* read-json-events handlers that leave by call-with-exit, call/cc and throw, 1000 times each; bench-run checks that
+	 *   each parse is abandoned and the next read-json of the same port still works
+	 */
+	{"json-events-escape", 3000,
+	 "(define bench-json-text \"{\\\"a\\\": [1, 2, {\\\"b\\\": 3}], \\\"c\\\": 4}\")  \n\
+	  (define (bench-escape how)                                           \n\
+	    (let ((p (open-input-string bench-json-text)))                      \n\
+	      (let ((r (case how                                               \n\
+	                 ((exit) (call-with-exit (lambda (k) (read-json-events (lambda (ev v) (if (eqv? v 2) (k 2))) p)))) \n\
+	                 ((cc) (call/cc (lambda (k) (read-json-events (lambda (ev v) (if (eqv? v 3) (k 3))) p)))) \n\
+	                 (else (catch 'bench-stop (lambda () (read-json-events (lambda (ev v) (if (eqv? v 4) (throw 'bench-stop 4))) p)) (lambda (t i) (car i))))))) \n\
+	        (unless (and (memv r '(2 3 4)) (hash-table? (read-json p)))     \n\
+	          (error 'bench-check \"read-json-events ~A escape returned ~S\" how r)))))   \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 1000))                                    \n\
+	      (bench-escape 'exit) (bench-escape 'cc) (bench-escape 'throw)))"},
+
+	/* 1000 rows of CSV, split into typed columns */
+	{"csv", 1000,
+	 "(define bench-csv                                                     \n\
+	    (call-with-output-string                                            \n\
+	      (lambda (p)                                                       \n\
+	        (format p \"id,name,price,qty~%\")                              \n\
+	        (do ((i 0 (+ i 1))) ((= i 1000))                                \n\
+	          (format p \"~D,item-~D,~A,~D~%\" i (modulo i 100) (* i 1.25) (modulo i 7)))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (read-csv (open-input-string bench-csv)))"},
+
+	/* read-csv of a row with too few fields, from a string port and a file port, all at once and continuing after a rows
+	 *   argument; bench-run raises an error if the message doesn't give the malformed row's line
+	 */
+	{"csv-error-line", 4000,
+	 "(define bench-csv-bad \"a,b\\n1,2\\n\\n3,4\\n5\\n6,7\\n\")                 \n\
+	  (call-with-output-file \"shack-bench-csv.tmp\" (lambda (p) (write-string bench-csv-bad p))) \n\
+	  (define (bench-csv-line open rows)                                   \n\
+	    (let ((p (open)))                                                   \n\
+	      (catch 'read-error                                                \n\
+	        (lambda () (if rows (read-csv p #\\, #t #f rows)) (read-csv p #\\, (not rows)) #f) \n\
+	        (lambda (type info) (close-input-port p) (apply format #f info))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 1000))                                    \n\
+	      (for-each (lambda (open)                                          \n\
+	                  (for-each (lambda (rows)                              \n\
+	                              (let ((msg (bench-csv-line open rows)))   \n\
+	                                (unless (and (string? msg) (string-position \"line 5\" msg)) \n\
+	                                  (error 'bench-check \"read-csv reported ~S\" msg)))) \n\
+	                            '(#f 1)))                                   \n\
+	                (list (lambda () (open-input-string bench-csv-bad)) (lambda () (open-input-file \"shack-bench-csv.tmp\"))))))"},
+
+	/* string=?, string<? and string-ci=? on two equal strings (so the whole string is compared), at three sizes */
+	{"string-cmp-16", 100000,
+	 "(define bench-str1 (make-string 16 #\\a))                             \n\
+	  (define bench-str2 (make-string 16 #\\a))                             \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000))                                  \n\
+	      (string=? bench-str1 bench-str2)                                  \n\
+	      (string<? bench-str1 bench-str2)                                  \n\
+	      (string-ci=? bench-str1 bench-str2)))"},
+
+	{"string-cmp-256", 100000,
+	 "(define bench-str1 (make-string 256 #\\a))                            \n\
+	  (define bench-str2 (make-string 256 #\\a))                            \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000))                                  \n\
+	      (string=? bench-str1 bench-str2)                                  \n\
+	      (string<? bench-str1 bench-str2)                                  \n\
+	      (string-ci=? bench-str1 bench-str2)))"},
+
+	{"string-cmp-64k", 1000,
+	 "(define bench-str1 (make-string 65536 #\\a))                          \n\
+	  (define bench-str2 (make-string 65536 #\\a))                          \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 1000))                                    \n\
+	      (string=? bench-str1 bench-str2)                                  \n\
+	      (string<? bench-str1 bench-str2)                                  \n\
+	      (string-ci=? bench-str1 bench-str2)))"},
+
+	/* split a 10000 character line into 100 fixed-width fields and save them, copying each one, then sharing them */
+	{"substring", 100000,
+	 "(define bench-line (make-string 10000 #\\a))                         \n\
+	  (define bench-fields (make-vector 100 #f))                            \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((k 0 (+ k 1))) ((= k 1000))                                    \n\
+	      (do ((i 0 (+ i 100))) ((= i 10000))                              \n\
+	        (vector-set! bench-fields (quotient i 100) (substring bench-line i (+ i 100))))))"},
+
+	{"substring-shared", 100000,
+	 "(define bench-line (make-string 10000 #\\a))                         \n\
+	  (define bench-fields (make-vector 100 #f))                            \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((k 0 (+ k 1))) ((= k 1000))                                    \n\
+	      (do ((i 0 (+ i 100))) ((= i 10000))                              \n\
+	        (vector-set! bench-fields (quotient i 100) (substring/shared bench-line i (+ i 100))))))"},
+
+	/* views of strings that are otherwise garbage, kept only in a string? vector, a typed hash-table, and a string port;
+	 *   bench-run raises an error if a GC freed any of the originals
+	 */
+	{"substring-shared-gc", 100,
+	 "(define (bench-views)                                                 \n\
+	    (let ((v (make-vector 100 \"\" string?))                             \n\
+	          (h (make-hash-table 8 string=? (cons string? string?))))      \n\
+	      (do ((i 0 (+ i 1))) ((= i 100) (list v h (open-input-string (substring/shared (make-string 16 #\\p) 8)))) \n\
+	        (let ((line (make-string 8 (integer->char (+ 65 (modulo i 26)))))) \n\
+	          (vector-set! v i (substring/shared (copy line) 1))            \n\
+	          (hash-table-set! h (substring/shared (copy line) 2) (substring/shared (copy line) 3)))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (let ((views (bench-views)))                                        \n\
+	      (gc) (do ((i 0 (+ i 1))) ((= i 300)) (make-string 8 #\\z)) (gc)   \n\
+	      (do ((i 0 (+ i 1))) ((= i 100))                                   \n\
+	        (let ((c (integer->char (+ 65 (modulo i 26)))))                 \n\
+	          (unless (and (string=? (vector-ref (car views) i) (make-string 7 c)) \n\
+	                       (string=? (hash-table-ref (cadr views) (make-string 6 c)) (make-string 5 c))) \n\
+	            (error 'bench-check \"view ~D lost its string\" i))))    \n\
+	      (unless (string=? (read-string 8 (caddr views)) \"pppppppp\")   \n\
+	        (error 'bench-check \"string port lost its string\"))))"},
+
+	{"printer", 2000,
+	 "(define bench-data (list 1 2.5 \"str\" #\\c 'sym (vector 1 2 3) (list 1/2 (list 'a \"b\")) (make-hash-table))) \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 2000))                                    \n\
+	      (object->string bench-data)))"},
+
+	{"format", 100000,
+	 "(define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000))                                  \n\
+	      (format #f \"request ~D from ~A: ~S~%\" i 'host \"ok\")))"},
+
+	/* the same control string, but not a constant, so format has to parse it every time */
+	{"format-dynamic", 100000,
+	 "(define bench-control (string-append \"request ~D \" \"from ~A: ~S~%\"))  \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000))                                  \n\
+	      (format #f bench-control i 'host \"ok\")))"},
+
+	{"formatter", 100000,
+	 "(define bench-formatter (make-formatter (string-append \"request ~D \" \"from ~A: ~S~%\"))) \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000))                                  \n\
+	      (format #f bench-formatter i 'host \"ok\")))"},
+
+	{"numeric-do", 1000000,
+	 "(define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1)) (x 0.0 (+ x (* 0.5 i)))) ((= i 1000000) x)))"},
+
+	{"call/cc", 100000,
+	 "(define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1)) (sum 0 (+ sum (call/cc (lambda (k) (k i)))))) ((= i 100000) sum)))"},
+
+	{"throw-catch", 100000,
+	 "(define (bench-throw i) (if (odd? i) (throw 'bench-odd i) i))         \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))                                                  \n\
+	         (n 0 (+ n (catch 'bench-odd (lambda () (bench-throw i)) (lambda (tag args) (car args)))))) \n\
+	        ((= i 100000) n)))"},
+
+	{"error-catch", 100000,
+	 "(define bench-digits (vector 0 1 2 3 4 5 6 7 8 9))                     \n\
+	  (define (bench-digit i) (catch 'out-of-range (lambda () (vector-ref bench-digits i)) (lambda (type info) -1))) \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1)) (n 0 (+ n (bench-digit (modulo i 20))))) ((= i 100000) n)))"},
+
+	{"iterator-pipeline", 100000,
+	 "(define bench-vector (let ((v (make-vector 100000))) (do ((i 0 (+ i 1))) ((= i 100000) v) (vector-set! v i i)))) \n\
+	  (define (bench-run)                                                   \n\
+	    (iterator-fold (lambda (x sum) (+ x sum)) 0                         \n\
+	      (iterator-filter even? (iterator-map (lambda (x) (* x 3)) bench-vector))))"},
+
+	{"iterator-escape", 20000,
+	 "(define bench-list (list 1 2 3 4))                                     \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))                                                  \n\
+	         (n 0 (+ n (call-with-exit (lambda (k) (iterator-fold (lambda (x a) (if (= x 3) (k a) (+ a x))) 0 bench-list))) \n\
+	                   (call/cc (lambda (k) (iterator-fold (lambda (x a) (if (= x 3) (k a) (+ a x))) 0 bench-list)))))) \n\
+	        ((= i 10000) n)))"},
+
+	{"table-group-by", 100000,
+	 "(define bench-table (make-table 100000 '((region integer?) (price float?)))) \n\
+	  (let ((r (table-column bench-table 'region)) (p (table-column bench-table 'price))) \n\
+	    (do ((i 0 (+ i 1))) ((= i 100000)) (int-vector-set! r i (modulo (* i 7919) 100)) (float-vector-set! p i (* i 0.5)))) \n\
+	  (define (bench-run)                                                   \n\
+	    (table-group-by (table-select bench-table (table-mask bench-table 'price (lambda (x) (> x 1000.0)))) 'region 'sum 'price))"},
+
+	{"coroutine-yield", 100000,
+	 "(define (bench-run)                                                   \n\
+	    (let ((gen (make-coroutine (lambda () (do ((i 0 (+ i 1))) ((= i 100000) 0) (yield i)))))) \n\
+	      (do ((i 0 (+ i 1)) (sum 0 (+ sum (resume gen)))) ((= i 100000) sum))))"},
+
+	{"run-coroutines", 100000,
+	 "(define bench-count 0)                                                \n\
+	  (define (bench-run)                                                   \n\
+	    (do ((i 0 (+ i 1))) ((= i 1000))                                    \n\
+	      (spawn (lambda () (do ((j 0 (+ j 1))) ((= j 100) (values j bench-count)) (set! bench-count (+ bench-count 1)) (yield))))) \n\
+	    (run-coroutines))"},
+
+	{"recursion", 32767,
+	 "(define (bench-build n) (if (= n 0) 'x (cons (bench-build (- n 1)) (bench-build (- n 1))))) \n\
+	  (define bench-tree (bench-build 14))                                 \n\
+	  (define (bench-leaves t)                                              \n\
+	    (cond ((pair? t) (+ (bench-leaves (car t)) (bench-leaves (cdr t)))) \n\
+	          ((null? t) 0)                                                 \n\
+	          (else 1)))                                                    \n\
+	  (define (bench-run) (bench-leaves bench-tree))"},
+
+	{"sort", 10000,
+	 "(define bench-random (let ((v (make-vector 10000))) (do ((i 0 (+ i 1))) ((= i 10000) v) (vector-set! v i (random 1000000))))) \n\
+	  (define (bench-run)                                                   \n\
+	    (sort! (copy bench-random) <))"},
+
+	{NULL, 0, NULL}
+};
+
+static double now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((double)t.tv_sec * 1.0e9 + (double)t.tv_nsec);
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return ((x < y) ? -1 : ((x > y) ? 1 : 0));
+}
+
+static shack_int gc_stat(shack_scheme* sc, const char* field)
+{
+	char expr[128];
+	snprintf(expr, 128, "((*shack* 'gc-counters) '%s)", field);
+	return (shack_integer(shack_eval_c_string(sc, expr)));
+}
+
+typedef struct
+{
+	char name[64];
+	double ns_per_op, cells_per_op, bytes_per_op;
+} result_t;
+
+typedef struct
+{
+	double p50_ns, p99_ns, p999_ns, max_ns;
+} latency_t;
+
+#define LATENCY_INSERTS 2000000
+
+static void insert_latency(shack_scheme* sc, int runs, latency_t* lat)
+{
+	/* the keys are made ahead of time so that the inserts themselves allocate no cells (hash entries aren't cells),
+	 *   and there's no GC in the timings -- what's left is the insert, including any resizing
+	 */
+	shack_pointer keys;
+	shack_int i, keys_loc;
+	double* times, * p50s, * p99s, * p999s, * maxes;
+	int k;
+
+	keys = shack_make_vector(sc, LATENCY_INSERTS);
+	keys_loc = shack_gc_protect(sc, keys);
+	for (i = 0; i < LATENCY_INSERTS; i++)
+		shack_vector_set(sc, keys, i, shack_make_integer(sc, i * 7919));
+	times = (double*)malloc(LATENCY_INSERTS * sizeof(double));
+	p50s = (double*)malloc(runs * sizeof(double));
+	p99s = (double*)malloc(runs * sizeof(double));
+	p999s = (double*)malloc(runs * sizeof(double));
+	maxes = (double*)malloc(runs * sizeof(double));
+
+	for (k = 0; k < runs; k++)
+	{
+		shack_pointer table;
+		shack_int table_loc;
+		table = shack_make_hash_table(sc, 8);
+		table_loc = shack_gc_protect(sc, table);
+		for (i = 0; i < LATENCY_INSERTS; i++)
+		{
+			double start;
+			start = now_ns();
+			shack_hash_table_set(sc, table, shack_vector_ref(sc, keys, i), keys);
+			times[i] = now_ns() - start;
+		}
+		shack_gc_unprotect_at(sc, table_loc);
+		qsort((void*)times, LATENCY_INSERTS, sizeof(double), compare_doubles);
+		p50s[k] = times[LATENCY_INSERTS / 2];
+		p99s[k] = times[(LATENCY_INSERTS / 100) * 99];
+		p999s[k] = times[(LATENCY_INSERTS / 1000) * 999];
+		maxes[k] = times[LATENCY_INSERTS - 1];
+	}
+	qsort((void*)p50s, runs, sizeof(double), compare_doubles);
+	qsort((void*)p99s, runs, sizeof(double), compare_doubles);
+	qsort((void*)p999s, runs, sizeof(double), compare_doubles);
+	qsort((void*)maxes, runs, sizeof(double), compare_doubles);
+	lat->p50_ns = p50s[runs / 2];
+	lat->p99_ns = p99s[runs / 2];
+	lat->p999_ns = p999s[runs / 2];
+	lat->max_ns = maxes[runs / 2];
+
+	shack_gc_unprotect_at(sc, keys_loc);
+	free(times);
+	free(p50s);
+	free(p99s);
+	free(p999s);
+	free(maxes);
+}
+
+#define C_CALLS 1000000
+#define BATCH_SIZE 1000
+
+static const char* c_call_names[3] = {"shack-call", "prepared-call", "batch-call"};
+
+static void c_call(shack_scheme* sc, int runs, int mode, double* times, result_t* result)
+{
+	shack_pointer func, args[2];
+	shack_call_t* call;
+	shack_batch_call_t* batch;
+	shack_int i, cells, bytes;
+	int k;
+
+	shack_eval_c_string(sc, "(define (bench-handler id x) (if (> x id) (- x id) (+ x id)))");
+	func = shack_name_to_value(sc, "bench-handler");
+	args[0] = shack_make_integer(sc, 12);
+	args[1] = shack_make_integer(sc, 34);
+	call = shack_prepare_call(sc, func, 2);
+	batch = (shack_batch_call_t*)malloc(BATCH_SIZE * sizeof(shack_batch_call_t));
+	for (i = 0; i < BATCH_SIZE; i++)
+	{
+		batch[i].func = func;
+		batch[i].args = args;
+		batch[i].nargs = 2;
+	}
+
+	cells = gc_stat(sc, "cells-allocated");
+	bytes = gc_stat(sc, "mallocate-bytes");
+	for (k = 0; k < runs; k++)
+	{
+		double start;
+		start = now_ns();
+		if (mode == 0)
+			for (i = 0; i < C_CALLS; i++)
+				shack_call(sc, func, shack_cons(sc, args[0], shack_cons(sc, args[1], shack_nil(sc))));
+		else if (mode == 1)
+			for (i = 0; i < C_CALLS; i++)
+				shack_call_prepared(sc, call, args);
+		else
+			for (i = 0; i < C_CALLS; i += BATCH_SIZE)
+				shack_call_batch(sc, batch, BATCH_SIZE);
+		times[k] = now_ns() - start;
+	}
+	cells = gc_stat(sc, "cells-allocated") - cells;
+	bytes = gc_stat(sc, "mallocate-bytes") - bytes;
+	shack_free_call(sc, call);
+	free(batch);
+	qsort((void*)times, runs, sizeof(double), compare_doubles);
+
+	snprintf(result->name, 64, "%s", c_call_names[mode]);
+	result->ns_per_op = times[runs / 2] / C_CALLS;
+	result->cells_per_op = (double)cells / (double)(C_CALLS * runs);
+	result->bytes_per_op = (double)bytes / (double)(C_CALLS * runs);
+}
+
+static int read_baseline(const char* filename, result_t* results, int size)
+{
+	/* we only read what write_results writes: one benchmark per line */
+	FILE* fp;
+	char line[512];
+	int n = 0;
+
+	fp = fopen(filename, "r");
+	if (!fp)
+	{
+		fprintf(stderr, "can't read baseline %s\n", filename);
+		return (0);
+	}
+	while ((n < size) && (fgets(line, 512, fp)))
+		if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf, \"cells_per_op\": %lf, \"bytes_per_op\": %lf}",
+			results[n].name, &results[n].ns_per_op, &results[n].cells_per_op, &results[n].bytes_per_op) == 4)
+			n++;
+	fclose(fp);
+	return (n);
+}
+
+static void show_result(result_t* r, result_t* baseline, int baseline_size)
+{
+	int k;
+	fprintf(stderr, "%-12s %12.1f ns/op %10.2f cells/op %10.2f bytes/op", r->name, r->ns_per_op, r->cells_per_op, r->bytes_per_op);
+	for (k = 0; k < baseline_size; k++)
+		if (strcmp(baseline[k].name, r->name) == 0)
+		{
+			fprintf(stderr, "   %+6.1f%% time, %+.2f cells/op",
+				100.0 * (r->ns_per_op - baseline[k].ns_per_op) / baseline[k].ns_per_op,
+				r->cells_per_op - baseline[k].cells_per_op);
+			break;
+		}
+	fprintf(stderr, "\n");
+}
+
+static void write_results(FILE* fp, result_t* results, int n, int runs, latency_t* lat)
+{
+	int i;
+	fprintf(fp, "{\"version\": \"%s\", \"runs\": %d, \"benchmarks\": [\n", SHACK_VERSION, runs);
+	for (i = 0; i < n; i++)
+		fprintf(fp, "  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"cells_per_op\": %.3f, \"bytes_per_op\": %.3f}%s\n",
+			results[i].name, results[i].ns_per_op, results[i].cells_per_op, results[i].bytes_per_op, (i < n - 1) ? "," : "");
+	if (lat)
+		fprintf(fp, "], \"latency\": [\n  {\"name\": \"hash-insert-latency\", \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}\n",
+			lat->p50_ns, lat->p99_ns, lat->p999_ns, lat->max_ns);
+	fprintf(fp, "]}\n");
+}
+
+int main(int argc, char** argv)
+{
+	shack_scheme* sc;
+	result_t results[64], baseline[64];
+	latency_t latency, * lat = NULL;
+	int i, n = 0, runs = 7, baseline_size = 0;
+	const char* only = NULL, * save = NULL;
+	double* times;
+
+	for (i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "--runs") == 0) && (i + 1 < argc))
+			runs = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "--only") == 0) && (i + 1 < argc))
+			only = argv[++i];
+		else if ((strcmp(argv[i], "--save") == 0) && (i + 1 < argc))
+			save = argv[++i];
+		else if ((strcmp(argv[i], "--baseline") == 0) && (i + 1 < argc))
+			baseline_size = read_baseline(argv[++i], baseline, 64);
+		else
+		{
+			fprintf(stderr, "usage: %s [--runs n] [--only name] [--save file.json] [--baseline file.json]\n", argv[0]);
+			return (1);
+		}
+	}
+	if (runs < 1)
+		runs = 1;
+	times = (double*)malloc(runs * sizeof(double));
+
+	sc = shack_init();
+	for (i = 0; workloads[i].name; i++)
+	{
+		workload_t* w = &workloads[i];
+		shack_int cells, bytes;
+		int k;
+		char code[2048];
+
+		if ((only) && (strcmp(only, w->name) != 0))
+			continue;
+		snprintf(code, 2048, "(begin %s)", w->code); /* shack_eval_c_string only evaluates the first form */
+		shack_eval_c_string(sc, code);
+		/* warm up (the optimizer runs on the first call); a workload that checks its results raises an error if they're wrong */
+		if (shack_eval_c_string(sc, "(catch #t (lambda () (bench-run) #t) (lambda (type info) (format *stderr* \"~S ~S~%\" type info) #f))") == shack_f(sc))
+		{
+			fprintf(stderr, "%s failed\n", w->name);
+			return (1);
+		}
+
+		cells = gc_stat(sc, "cells-allocated");
+		bytes = gc_stat(sc, "mallocate-bytes");
+		for (k = 0; k < runs; k++)
+		{
+			double start;
+			start = now_ns();
+			shack_eval_c_string(sc, "(bench-run)");
+			times[k] = now_ns() - start;
+		}
+		/* the two gc_stat calls themselves allocate a few cells, but that's noise next to ops*runs */
+		cells = gc_stat(sc, "cells-allocated") - cells;
+		bytes = gc_stat(sc, "mallocate-bytes") - bytes;
+		qsort((void*)times, runs, sizeof(double), compare_doubles);
+
+		snprintf(results[n].name, 64, "%s", w->name);
+		results[n].ns_per_op = times[runs / 2] / w->ops;
+		results[n].cells_per_op = (double)cells / (double)(w->ops * runs);
+		results[n].bytes_per_op = (double)bytes / (double)(w->ops * runs);
+
+		show_result(&results[n], baseline, baseline_size);
+		n++;
+	}
+	for (i = 0; i < 3; i++)
+		if ((!only) || (strcmp(only, c_call_names[i]) == 0))
+		{
+			c_call(sc, runs, i, times, &results[n]);
+			show_result(&results[n], baseline, baseline_size);
+			n++;
+		}
+	free(times);
+
+	if ((!only) || (strcmp(only, "hash-insert-latency") == 0))
+	{
+		insert_latency(sc, runs, &latency);
+		lat = &latency;
+		fprintf(stderr, "%-12s %12.1f ns p50 %10.1f ns p99 %10.1f ns p99.9 %12.1f ns max\n", "hash-insert-latency",
+			lat->p50_ns, lat->p99_ns, lat->p999_ns, lat->max_ns);
+	}
+
+	if (save)
+	{
+		FILE* fp;
+		fp = fopen(save, "w");
+		if (!fp)
+		{
+			fprintf(stderr, "can't write %s\n", save);
+			return (1);
+		}
+		write_results(fp, results, n, runs, lat);
+		fclose(fp);
+	}
+	else
+		write_results(stdout, results, n, runs, lat);
+	return (0);
+}
@@ -104,6 +104,39 @@
 (defvar c-define-output-file-counter 0)   ; ugly, but I can't find a way around this (dlopen/dlsym stupidity)
 
 
+;;; --------------------------------------------------------------------------------
+;;; compiled libraries are cached in *cload-directory* under a name that includes a hash of
+;;;   the generated C text, the compiler and its flags, and the shack version:
+;;;     libc_shack-8c1e5b0d2f6a9e47.so
+;;; so a library is compiled only once per distinct build, and later loads go straight to dlopen.
+;;; If c-define has an output-name, <output-name>.so is a symlink to the newest build (libc_shack.so for libc.scm).
+;;; Each build happens in a private temporary file that is renamed into place when the compiler
+;;;   is done, so concurrent processes never see (or dlopen) a half-written .so.
+;;; (set! *cload-cache* #f) to force recompilation.
+
+(defvar *cload-cache* #t)
+
+(define (cload-hash str)
+  ;; two 32-bit FNV-1a lanes with different offset bases, returned as 16 hex digits
+  (let ((len (length str)))
+    (do ((i 0 (+ i 1))
+	 (h1 2166136261 (logand (* (logxor h1 (char->integer (string-ref str i))) 16777619) #xffffffff))
+	 (h2 (logxor 1540483477 len) (logand (* (logxor h2 (char->integer (string-ref str (- len i 1)))) 16777619) #xffffffff)))
+	((= i len)
+	 (format #f "~8,'0X~8,'0X" h1 h2)))))
+
+(define (cload-cache-key c-text . flags)
+  (cload-hash (apply string-append c-text (shack-version) *cload-c-compiler* *cload-cflags* *cload-ldflags* flags)))
+
+(define (cload-temporary-name base)
+  ;; mktemp creates the file, so the name is ours alone; the caller deletes it when done
+  (let ((name (system (string-append "mktemp " base "-XXXXXX") #t)))
+    (if (and (> (length name) 0)
+	     (char=? (string-ref name (- (length name) 1)) #\newline))
+	(substring name 0 (- (length name) 1))
+	(format #f "~A-~D" base (random 1000000000)))))
+
+
 ;;; to place the new function in the caller's current environment, we need to pass the environment in explicitly:
 (define-macro (c-define . args) 
   (cons 'c-define-1 (cons '(curlet) args)))
@@ -198,11 +231,8 @@
 				  (if (and (> (length *cload-directory*) 0)
 					   (not (char=? (string-ref *cload-directory* (- (length *cload-directory*) 1)) #\/)))
 				      "/" "")
-				  (or output-name (format #f "temp-shack-output-~D" c-define-output-file-counter)))))
-    (let ((c-file-name (string-append file-name ".c"))
-	  (o-file-name (string-append file-name ".o"))
-	  (so-file-name (string-append file-name ".so"))
-	  (init-name (if (string? output-name)
+				  (or output-name "temp-shack-output"))))
+    (let ((init-name (if (string? output-name)
 			 (string-append output-name "_init")
 			 (string-append "init_" (number->string c-define-output-file-counter))))
 	  (functions ())
@@ -262,7 +292,7 @@
       
       (define (initialize-c-file)
 	;; C header stuff
-	(set! p (open-output-file c-file-name))
+	(set! p (open-output-string))
 	(format p "#include <stdlib.h>~%")
 	(format p "#include <stdio.h>~%")
 	(format p "#include <string.h>~%")
@@ -566,40 +596,58 @@
 	   int-funcs))
 	
 	(format p "}~%")
-	(close-output-port p)
-	
-	;; now we have the module .c file -- make it into a shared object, load it, delete the temp files
-	
-	(cond ((provided? 'osx)
-	       ;; I assume the caller is also compiled with these flags?
-	       (system (format #f "~A -c ~A -o ~A ~A ~A" 
-			       *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
-	       (system (format #f "~A ~A -o ~A -dynamic -bundle -undefined suppress -flat_namespace ~A ~A" 
-			       *cload-c-compiler* o-file-name so-file-name *cload-ldflags* ldflags)))
-	      
-	      ((provided? 'freebsd)
-	       (system (format #f "cc -fPIC -c ~A -o ~A ~A ~A" 
-			       c-file-name o-file-name *cload-cflags* cflags))
-	       (system (format #f "cc ~A -shared -o ~A ~A ~A" 
-			       o-file-name so-file-name *cload-ldflags* ldflags)))
-	      
-	      ((provided? 'openbsd)
-	       (system (format #f "~A -fPIC -ftrampolines -c ~A -o ~A ~A ~A" 
-			       *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
-	       (system (format #f "~A ~A -shared -o ~A ~A ~A" 
-			       *cload-c-compiler* o-file-name so-file-name *cload-ldflags* ldflags)))
-	      
-	      ((provided? 'sunpro_c) ; just guessing here...
-	       (system (format #f "cc -c ~A -o ~A ~A ~A" 
-			       c-file-name o-file-name *cload-cflags* cflags))
-	       (system (format #f "cc ~A -G -o ~A ~A ~A" 
-			       o-file-name so-file-name *cload-ldflags* ldflags)))
-	      
-	      (else
-	       (system (format #f "~A -fPIC -c ~A -o ~A ~A ~A" 
-			       *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
-	       (system (format #f "~A ~A -shared -o ~A ~A ~A" 
-			       *cload-c-compiler* o-file-name so-file-name *cload-ldflags* ldflags)))))
+	(let ((c-text (get-output-string p)))
+	  (close-output-port p)
+	  c-text))
+
+      (define (compile-c-file c-text so-file-name)
+	;; write the module .c file, make it into a shared object under a private name,
+	;;   move that into its cache slot, delete the temp files
+	(let* ((tmp-file-name (cload-temporary-name file-name))
+	       (c-file-name (string-append tmp-file-name ".c"))
+	       (o-file-name (string-append tmp-file-name ".o"))
+	       (tmp-so-name (string-append tmp-file-name ".so")))
+	  (call-with-output-file c-file-name
+	    (lambda (port)
+	      (write-string c-text port)))
+
+	  (cond ((provided? 'osx)
+		 ;; I assume the caller is also compiled with these flags?
+		 (system (format #f "~A -c ~A -o ~A ~A ~A" 
+				 *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
+		 (system (format #f "~A ~A -o ~A -dynamic -bundle -undefined suppress -flat_namespace ~A ~A" 
+				 *cload-c-compiler* o-file-name tmp-so-name *cload-ldflags* ldflags)))
+		
+		((provided? 'freebsd)
+		 (system (format #f "cc -fPIC -c ~A -o ~A ~A ~A" 
+				 c-file-name o-file-name *cload-cflags* cflags))
+		 (system (format #f "cc ~A -shared -o ~A ~A ~A" 
+				 o-file-name tmp-so-name *cload-ldflags* ldflags)))
+		
+		((provided? 'openbsd)
+		 (system (format #f "~A -fPIC -ftrampolines -c ~A -o ~A ~A ~A" 
+				 *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
+		 (system (format #f "~A ~A -shared -o ~A ~A ~A" 
+				 *cload-c-compiler* o-file-name tmp-so-name *cload-ldflags* ldflags)))
+		
+		((provided? 'sunpro_c) ; just guessing here...
+		 (system (format #f "cc -c ~A -o ~A ~A ~A" 
+				 c-file-name o-file-name *cload-cflags* cflags))
+		 (system (format #f "cc ~A -G -o ~A ~A ~A" 
+				 o-file-name tmp-so-name *cload-ldflags* ldflags)))
+		
+		(else
+		 (system (format #f "~A -fPIC -c ~A -o ~A ~A ~A" 
+				 *cload-c-compiler* c-file-name o-file-name *cload-cflags* cflags))
+		 (system (format #f "~A ~A -shared -o ~A ~A ~A" 
+				 *cload-c-compiler* o-file-name tmp-so-name *cload-ldflags* ldflags))))
+
+	  (if (file-exists? tmp-so-name)
+	      (system (format #f "mv -f ~A ~A" tmp-so-name so-file-name))
+	      (format *stderr* "can't build ~A~%" so-file-name))
+	  (for-each (lambda (f) 
+		      (if (file-exists? f) (delete-file f)))
+		    (list c-file-name o-file-name tmp-so-name tmp-file-name))))
       
       (define handle-declaration 
 	(let ()
@@ -643,29 +691,37 @@
       
       
       ;; c-define-1 (called in c-define macro above)
-      (unless (and output-name
-		   (file-exists? c-file-name)
+      ;;   generate the C text, then compile it only if its cache slot is empty
+      (initialize-c-file)
+      
+      (if (and (pair? (cdr function-info))
+	       (symbol? (cadr function-info)))
+	  (handle-declaration function-info)
+	  (for-each handle-declaration function-info))
+      
+      (let* ((c-text (end-c-file))
+	     (so-suffix (string-append "-" (cload-cache-key c-text cflags ldflags) ".so"))
+	     (so-file-name (string-append file-name so-suffix))
+	     (link-name (string-append file-name ".so"))
+	     (build? (not (and *cload-cache*
+			       (file-exists? so-file-name)))))
+	(when build?
+	  (format *stderr* "compiling ~A~%" so-file-name)
+	  (compile-c-file c-text so-file-name))
+
+	;; <output-name>.so links to the newest build, so libc_shack.so is still where shack_repl looks for it
+	(when (and (string? output-name)
 		   (file-exists? so-file-name)
-		   (provided? 'system-extras)
-		   (>= (file-mtime so-file-name) (file-mtime c-file-name))
-		   (not (and (file-exists? (port-filename))
-			     (< (file-mtime so-file-name) (file-mtime (port-filename))))))
-	(format *stderr* "writing ~A~%" c-file-name)
-	;; write a new C file and compile it
-	(initialize-c-file)
-	
-	(if (and (pair? (cdr function-info))
-		 (symbol? (cadr function-info)))
-	    (handle-declaration function-info)
-	    (for-each handle-declaration function-info))
+		   (or build?
+		       (not (file-exists? link-name))))
+	  (let ((tmp-link-name (cload-temporary-name file-name)))
+	    (system (format #f "ln -sf ~A~A ~A && mv -f ~A ~A" output-name so-suffix tmp-link-name tmp-link-name link-name))
+	    (if (file-exists? tmp-link-name) (delete-file tmp-link-name))))
 	
-	(end-c-file)
-	(delete-file o-file-name))
-      
-      ;; load the object file, clean up
-      (varlet cur-env 'init_func (string->symbol init-name))
-      (format *stderr* "loading ~A~%" so-file-name)
-      (load so-file-name cur-env))))
+	;; load the object file
+	(varlet cur-env 'init_func (string->symbol init-name))
+	(format *stderr* "loading ~A~%" so-file-name)
+	(load so-file-name cur-env)))))
 
 
 #|